@@ -3,6 +3,7 @@
 #include <atomic>
 #include <chrono>
 #include <cmath>
+#include <sstream>
 #include <stdint.h>
 #include <unistd.h> // readlink()
 #include <glad/glad.h> // OpenGL loader
@@ -17,6 +18,8 @@
 #include "f3d/object_creator.hpp"
 #include "f3d/material_map.hpp"
 #include "f3d/shader.hpp"
+#include "file_follower.hpp"
+#include "derived_quantity.hpp"
 
 using json = nlohmann::json;
 
@@ -217,9 +220,12 @@ int main(int argc, char* argv[])
     bool drivers_shown = true; // true if drivers has to be rendered
     bool mat_shown[8]; // true if objects of this material has to be rendered
     bool vox_map_shown = false;
+    bool follow_mode = false; // true if displayed frame has to follow newest frame written by running simulation
     int last_key = 0; // last key of F1..9
 
     std::vector<f3d::scanner*> scanners;
+    std::vector<file_follower*> followers; // one for every scanner (same index)
+    std::vector<derived_quantity*> derived; // one for every scanner (same index)
     std::vector<f3d::object3d*> drivers;
     std::vector<f3d::object3d*> models;
     std::vector<uint8_t> models_mat; // material of each model
@@ -275,6 +281,16 @@ int main(int argc, char* argv[])
     f3d::shader object_shader((exec_path + "/f3d/vertex_object.glsl").c_str(), (exec_path + "/f3d/fragment_object.glsl").c_str()); // common shader for all objects except scanner and woxel maps
     f3d::shader voxel_shader((exec_path + "/f3d/vertex_mat_map.glsl").c_str(), (exec_path + "/f3d/fragment_mat_map.glsl").c_str()); // common shader for all voxel maps
 
+    // derived quantities of scanners are sampled from their own texture unit
+    GLint scanner_program;
+    scanner_shader.use();
+    glGetIntegerv(GL_CURRENT_PROGRAM, &scanner_program);
+    glUniform1i(glGetUniformLocation(scanner_program, "texture_of_derived"), derived_quantity::texture_unit);
+    GLint derived_mode_loc = glGetUniformLocation(scanner_program, "derived_mode");
+    // frames loaded by followers (follow mode) are sampled from another one
+    glUniform1i(glGetUniformLocation(scanner_program, "texture_of_followed"), file_follower::texture_unit);
+    GLint followed_loc = glGetUniformLocation(scanner_program, "followed");
+
     /*** Parse .json ***/
     try {
         int fcntr, cntr;
@@ -385,6 +401,30 @@ int main(int argc, char* argv[])
                 }
                 auto s = new f3d::scanner(scanner_shader, position, rotation, size, file_name, store_every_nth_frame);
                 scanners.push_back(s);
+                followers.push_back(new file_follower(file_name, size.x, size.y, store_every_nth_frame));
+                // optional derived quantity shown instead of raw values (can be changed later by "derived" command)
+                auto d = new derived_quantity(file_name, size.x, size.y, store_every_nth_frame);
+                if((val = jscan["derived"]).is_object())
+                {
+                    derived_quantity::mode_t mode;
+                    json dval;
+                    if(!(dval = val["mode"]).is_string() || !derived_quantity::parse_mode(dval.get<std::string>(), mode))
+                    {
+                        throw std::runtime_error("Field [" + std::to_string(fcntr) + "]: " \
+                            "scanner [" + std::to_string(cntr) + "]: derived \"mode\" has to be one of: none, diff, rms, peak");
+                    }
+                    if(!(dval = val["window"]).is_null() && (!dval.is_number_unsigned() || !d->set_window(dval.get<uint64_t>())))
+                    {
+                        throw std::runtime_error("Field [" + std::to_string(fcntr) + "]: " \
+                            "scanner [" + std::to_string(cntr) + "]: derived \"window\" has to be 1 .. " + std::to_string(d->max_window()));
+                    }
+                    if((dval = val["decay"]).is_number())
+                        d->set_decay(dval);
+                    if((dval = val["reference_frame"]).is_number_unsigned())
+                        d->set_reference(dval);
+                    d->set_mode(mode);
+                }
+                derived.push_back(d);
                 cntr++;
             }
 
@@ -484,6 +524,52 @@ int main(int argc, char* argv[])
             {
                 std::cout << "Last error: " << std::to_string(glGetError()) << "\n";
             }
+            else if(cmd_line.compare(0, 8, "derived ") == 0)
+            {
+                // derived none|diff|rms|peak, derived window <n>, derived decay <d>, derived reference
+                std::istringstream args(cmd_line.substr(8));
+                std::string arg;
+                double arg_value = 0.0;
+                bool has_value;
+                derived_quantity::mode_t mode;
+                args >> arg;
+                has_value = (bool)(args >> arg_value);
+                if((arg == "window" || arg == "decay") && !has_value) {
+                    std::cout << "Usage: derived window <frames>, derived decay <0 .. 1>\n";
+                }
+                else if(arg == "decay" && !(arg_value >= 0.0 && arg_value <= 1.0)) {
+                    std::cout << "Decay has to be 0 .. 1\n";
+                }
+                else {
+                    for( int i = 0; i < derived.size(); i++ ) {
+                        if(derived_quantity::parse_mode(arg, mode)) {
+                            derived[i]->set_mode(mode);
+                        }
+                        else if(arg == "window") {
+                            if(!(arg_value >= 1.0 && arg_value <= derived[i]->max_window()) || !derived[i]->set_window((uint64_t)arg_value)) {
+                                std::cout << "Scanner [" << i << "]: window has to be 1 .. " << derived[i]->max_window() << "\n";
+                                continue;
+                            }
+                        }
+                        else if(arg == "decay") {
+                            derived[i]->set_decay(arg_value);
+                        }
+                        else if(arg == "reference") {
+                            derived[i]->set_reference(frame);
+                        }
+                        else {
+                            std::cout << "Unknown derived quantity: " << arg << "\n";
+                            break;
+                        }
+                        derived[i]->load_frame(frame);
+                    }
+                }
+            }
+            else if(cmd_line == "follow")
+            {
+                follow_mode = !follow_mode;
+                std::cout << "Follow mode: " << (follow_mode ? "on" : "off") << "\n";
+            }
             std::cout << cmd_line << std::endl; // TODO: parse & do command
             cmd_flag = 0;
         }
@@ -594,6 +680,11 @@ int main(int argc, char* argv[])
                 mat_shown[7] = !mat_shown[7];
             last_key = GLFW_KEY_F8;
         }
+        else if(glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS) {
+            if(last_key != GLFW_KEY_F9)
+                follow_mode = !follow_mode;
+            last_key = GLFW_KEY_F9;
+        }
         else if(glfwGetKey(window, GLFW_KEY_F11) == GLFW_PRESS) {
             if(last_key != GLFW_KEY_F11)
                 drivers_shown = !drivers_shown;
@@ -618,11 +709,38 @@ int main(int argc, char* argv[])
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)viewport.z / viewport.w, 1.0f, 2.0f * scene_max_dim);
         camera = projection * camera;
         
+        // follow mode - jump to newest frame which is complete in all scanner files
+        if (follow_mode && !followers.empty())
+        {
+            unsigned int newest = UINT32_MAX;
+            unsigned int step;
+            bool all_ready = true;
+            for( int i = 0; i < followers.size(); i++ ) {
+                followers[i]->update(); // non-blocking
+                if(followers[i]->newest_frame(step)) {
+                    newest = std::min(newest, step);
+                } else {
+                    all_ready = false; // some scanner has no complete frame yet, wait
+                }
+            }
+            if (all_ready)
+            {
+                frame = newest;
+                if (frame >= num_frames)
+                    num_frames = frame + 1; // simulation is running longer than expected
+            }
+            // scanner itself knows only frames present at startup, followers read the rest
+            for( int i = 0; i < followers.size(); i++ ) {
+                followers[i]->load_frame(frame); // no-op if already loaded
+            }
+        }
+
         if (last_frame != frame)
         {
             // not same frame, load new values from files
             for( int i = 0; i < scanners.size(); i++ ) {
                 scanners[i]->load_frame(frame);
+                derived[i]->load_frame(frame);
             }
             last_frame = frame;
         }
@@ -630,6 +748,11 @@ int main(int argc, char* argv[])
         // render
         grid1.Draw(camera);
         for( int i = 0; i < scanners.size(); i++ ) {
+            glUseProgram(scanner_program);
+            glUniform1i(derived_mode_loc, derived[i]->has_result() ? derived[i]->get_mode() : derived_quantity::none);
+            glUniform1i(followed_loc, follow_mode ? 1 : 0);
+            derived[i]->bind();
+            followers[i]->bind();
             scanners[i]->Draw(camera);
         }
         if(vox_map_shown) {
@@ -0,0 +1,416 @@
+#include "derived_quantity.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif /* __SSE2__ */
+
+/*** SIMD kernels - all of them are O(n), scalar loop handles the tail ***/
+
+// out = a - b
+static void kernel_sub(float* out, const float* a, const float* b, size_t n)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for(; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#endif /* __SSE2__ */
+    for(; i < n; i++)
+        out[i] = a[i] - b[i];
+}
+
+// sum += add^2 - sub^2
+static void kernel_sum_sq_update(float* sum, const float* add, const float* sub, size_t n)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128 a = _mm_loadu_ps(add + i);
+        __m128 s = _mm_loadu_ps(sub + i);
+        __m128 d = _mm_sub_ps(_mm_mul_ps(a, a), _mm_mul_ps(s, s));
+        _mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), d));
+    }
+#endif /* __SSE2__ */
+    for(; i < n; i++)
+        sum[i] += add[i] * add[i] - sub[i] * sub[i];
+}
+
+// sum += a^2
+static void kernel_add_sq(float* sum, const float* a, size_t n)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(a + i);
+        _mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), _mm_mul_ps(v, v)));
+    }
+#endif /* __SSE2__ */
+    for(; i < n; i++)
+        sum[i] += a[i] * a[i];
+}
+
+// out = sqrt(sum / count), negative rounding residue of running sum is clamped to 0
+static void kernel_rms(float* out, const float* sum, float inv_count, size_t n)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 k = _mm_set1_ps(inv_count);
+    const __m128 zero = _mm_setzero_ps();
+    for(; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(sum + i), k), zero)));
+#endif /* __SSE2__ */
+    for(; i < n; i++)
+        out[i] = std::sqrt(std::max(sum[i] * inv_count, 0.0f));
+}
+
+// out = max(|a|, out * decay)
+static void kernel_peak_hold(float* out, const float* a, float decay, size_t n)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 k = _mm_set1_ps(decay);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_andnot_ps(sign, _mm_loadu_ps(a + i));
+        _mm_storeu_ps(out + i, _mm_max_ps(v, _mm_mul_ps(_mm_loadu_ps(out + i), k)));
+    }
+#endif /* __SSE2__ */
+    for(; i < n; i++)
+        out[i] = std::max(std::fabs(a[i]), out[i] * decay);
+}
+
+/*** derived_quantity ***/
+
+derived_quantity::derived_quantity(const std::string& file_name, uint32_t size_x, uint32_t size_y, uint32_t store_every_nth_frame)
+    : file_name(file_name), size_x(size_x), size_y(size_y), store_every_nth_frame(store_every_nth_frame)
+{
+    pixels = (size_t)size_x * size_y;
+    if(this->store_every_nth_frame < 1)
+        this->store_every_nth_frame = 1;
+}
+
+derived_quantity::~derived_quantity()
+{
+    if(texture)
+        glDeleteTextures(1, &texture);
+    if(fd >= 0)
+        close(fd);
+}
+
+void derived_quantity::set_mode(mode_t mode)
+{
+    this->mode = mode;
+    state_valid = false;
+    if(mode != rms && mode != peak_hold)
+    {
+        // release window memory, it may be large
+        std::vector<float>().swap(ring);
+        std::vector<float>().swap(sum_sq);
+    }
+}
+
+bool derived_quantity::set_window(uint64_t window)
+{
+    if(window < 1 || window > max_window())
+        return false;
+    this->window = (uint32_t)window;
+    state_valid = false;
+    return true;
+}
+
+uint32_t derived_quantity::max_window(void) const
+{
+    size_t frames = window_memory / std::max(pixels * sizeof(float), (size_t)1);
+    return (uint32_t)std::max(std::min(frames, (size_t)window_limit), (size_t)1);
+}
+
+void derived_quantity::set_decay(float decay)
+{
+    this->decay = std::min(std::max(decay, 0.0f), 1.0f);
+    state_valid = false;
+}
+
+void derived_quantity::set_reference(unsigned int step)
+{
+    reference_step = step;
+    reference_valid = false;
+    state_valid = false;
+}
+
+bool derived_quantity::parse_mode(const std::string& name, mode_t& mode)
+{
+    if(name == "none")
+        mode = none;
+    else if(name == "diff")
+        mode = difference;
+    else if(name == "rms")
+        mode = rms;
+    else if(name == "peak")
+        mode = peak_hold;
+    else
+        return false;
+    return true;
+}
+
+// reads one complete frame, returns false if frame is not (yet) in file
+bool derived_quantity::read_frame(uint32_t index, float* dst) const
+{
+    const size_t frame_bytes = pixels * sizeof(float);
+    size_t done = 0;
+    ssize_t len;
+
+    if(fd < 0)
+        return false;
+    while(done < frame_bytes)
+    {
+        len = pread(fd, (char*)dst + done, frame_bytes - done, (off_t)index * frame_bytes + done);
+        if(len <= 0)
+            return false;
+        done += len;
+    }
+    return true;
+}
+
+// clears in-memory state, the next advance() starts from nothing
+void derived_quantity::reset_state(void)
+{
+    if(mode == rms || mode == peak_hold)
+    {
+        ring.assign((size_t)window * pixels, 0.0f);
+        ring_pos = 0;
+        ring_filled = 0;
+    }
+    if(mode == rms)
+    {
+        sum_sq.assign(pixels, 0.0f);
+        updates = 0;
+    }
+    else if(mode == peak_hold)
+        std::fill(output.begin(), output.end(), 0.0f); // peak hold of zeros is |value|
+    state_valid = false;
+}
+
+// feeds one frame into state, O(pixels), returns false if frame is not (yet) in file
+bool derived_quantity::advance(uint32_t index)
+{
+    if(!read_frame(index, current.data()))
+        return false;
+
+    switch(mode)
+    {
+        case difference:
+            kernel_sub(output.data(), current.data(), reference.data(), pixels);
+            break;
+
+        case rms:
+        {
+            float* slot = &ring[(size_t)ring_pos * pixels]; // the oldest frame, zeros while window is not full
+            kernel_sum_sq_update(sum_sq.data(), current.data(), slot, pixels);
+            std::copy(current.begin(), current.end(), slot);
+            ring_pos = (ring_pos + 1) % window;
+            ring_filled = std::min(ring_filled + 1, window);
+            resum();
+            break;
+        }
+
+        case peak_hold:
+            kernel_peak_hold(output.data(), current.data(), decay, pixels);
+            // keep history of results, so stepping back doesn't need to recompute
+            std::copy(output.begin(), output.end(), ring.begin() + (size_t)ring_pos * pixels);
+            ring_pos = (ring_pos + 1) % window;
+            ring_filled = std::min(ring_filled + 1, window);
+            break;
+
+        default:
+            return false;
+    }
+    return true;
+}
+
+// takes frame "last_index" back out of state, O(pixels), returns false if state can't go back
+bool derived_quantity::retreat(void)
+{
+    uint32_t newest = (ring_pos + window - 1) % window; // slot of frame "last_index"
+    float* slot = &ring[(size_t)newest * pixels];
+
+    if(last_index == 0 || ring_filled < 1)
+        return false;
+
+    switch(mode)
+    {
+        case rms:
+            // the newest frame leaves window, frame "last_index - window" enters it again (into the same slot)
+            if(last_index >= window)
+            {
+                if(!read_frame(last_index - window, current.data()))
+                    return false;
+            }
+            else
+            {
+                std::fill(current.begin(), current.end(), 0.0f);
+                ring_filled--;
+            }
+            kernel_sum_sq_update(sum_sq.data(), current.data(), slot, pixels);
+            std::copy(current.begin(), current.end(), slot);
+            ring_pos = newest;
+            resum();
+            break;
+
+        case peak_hold:
+            // previous result is in history
+            if(ring_filled < 2)
+                return false;
+            std::copy_n(ring.begin() + (size_t)((newest + window - 1) % window) * pixels, pixels, output.begin());
+            ring_pos = newest;
+            ring_filled--;
+            break;
+
+        default:
+            return false;
+    }
+    last_index--;
+    return true;
+}
+
+// once per window updates: sum again from scratch so rounding errors of running sum can't accumulate
+void derived_quantity::resum(void)
+{
+    if(++updates < window)
+        return;
+    updates = 0;
+    std::fill(sum_sq.begin(), sum_sq.end(), 0.0f);
+    for(uint32_t i = 0; i < window; i++)
+        kernel_add_sq(sum_sq.data(), &ring[(size_t)i * pixels], pixels);
+}
+
+// number of frames which determine the result, state is rebuilt from them after a long jump
+uint32_t derived_quantity::rebuild_depth(void) const
+{
+    if(mode != peak_hold)
+        return window;
+    // peak hold: older frames have decayed below peak_epsilon of their height
+    if(decay <= 0.0f)
+        return 1;
+    if(decay >= 1.0f)
+        return UINT32_MAX; // held forever - feed everything from frame 0
+    return (uint32_t)std::min(std::ceil(std::log(peak_epsilon) / std::log(decay)) + 1.0, (double)UINT32_MAX);
+}
+
+void derived_quantity::load_frame(unsigned int step)
+{
+    uint32_t index = step / store_every_nth_frame;
+    uint32_t first; // first frame fed into state
+    struct stat st;
+
+    if(mode == none)
+        return;
+    if(fd >= 0 && fstat(fd, &st) == 0 &&
+        (st.st_nlink == 0 || (state_valid && (size_t)st.st_size < (last_index + 1) * pixels * sizeof(float))))
+    {
+        // simulation was restarted (file re-created or truncated) - drop everything computed from old data
+        close(fd);
+        fd = -1;
+        state_valid = false;
+        reference_valid = false;
+    }
+    if(state_valid && index == last_index)
+        return; // already computed
+    if(fd < 0)
+    {
+        // simulation may not have created the file yet
+        fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            return;
+    }
+    current.resize(pixels);
+    output.resize(pixels);
+
+    if(mode == difference)
+    {
+        if(!reference_valid)
+        {
+            reference.resize(pixels);
+            reference_valid = read_frame(reference_step / store_every_nth_frame, reference.data());
+            if(!reference_valid)
+                return;
+        }
+        first = index; // no history needed
+    }
+    else if(state_valid && index > last_index && index - last_index < rebuild_depth())
+    {
+        // forward skip (follow mode, fast motion): feed all skipped frames, O(pixels * skipped)
+        first = last_index + 1;
+    }
+    else
+    {
+        // short step back: take frames out of state one by one, O(pixels * skipped)
+        if(state_valid && index < last_index && last_index - index < window)
+        {
+            while(last_index > index)
+            {
+                if(!retreat())
+                    break;
+            }
+        }
+        if(state_valid && index == last_index)
+        {
+            first = index + 1; // nothing more to feed
+        }
+        else
+        {
+            // long jump: rebuild from last rebuild_depth() frames
+            reset_state();
+            first = (index + 1 >= rebuild_depth()) ? index + 1 - rebuild_depth() : 0;
+        }
+    }
+
+    for(uint32_t i = first; i <= index; i++)
+    {
+        if(!advance(i))
+            break; // frame not written yet - keep state of the last complete one, continue next time
+        last_index = i;
+        state_valid = true;
+    }
+    if(!state_valid)
+        return;
+    if(mode == rms)
+        kernel_rms(output.data(), sum_sq.data(), 1.0f / ring_filled, pixels);
+    upload();
+}
+
+void derived_quantity::upload(void)
+{
+    // never touch unit 0, scanner's own texture may rely on staying bound there
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    if(!texture)
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // float texture - values are NOT saturated to 0 .. 1 (unlike raw scanner texture)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size_x, size_y, 0, GL_RED, GL_FLOAT, output.data());
+    }
+    else
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size_x, size_y, GL_RED, GL_FLOAT, output.data());
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void derived_quantity::bind(void) const
+{
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glActiveTexture(GL_TEXTURE0);
+}
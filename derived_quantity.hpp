@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <glad/glad.h>
+
+// Compute stage between scanner frame loading and fragment_scanner.glsl.
+// Reads the same .f32 file as scanner, computes derived quantity on CPU (SIMD kernels)
+// and uploads it into its own R32F texture. Window state is kept in memory, so stepping
+// by one frame costs O(pixels) in both directions; only jumps over whole window rebuild the state.
+class derived_quantity
+{
+public:
+    enum mode_t
+    {
+        none = 0,       // raw scanner values
+        difference = 1, // current frame minus reference frame
+        rms = 2,        // running RMS over last "window" frames
+        peak_hold = 3   // |value| with exponential decay peak hold
+    };
+
+    derived_quantity(const std::string& file_name, uint32_t size_x, uint32_t size_y, uint32_t store_every_nth_frame = 1);
+    ~derived_quantity();
+    derived_quantity(const derived_quantity&) = delete;
+    derived_quantity& operator=(const derived_quantity&) = delete;
+
+    // any change of settings invalidates in-memory state, next load_frame() rebuilds it
+    void set_mode(mode_t mode);
+    // returns false (and keeps previous window) if window is 0 or above max_window()
+    bool set_window(uint64_t window);
+    void set_decay(float decay);
+    void set_reference(unsigned int step);
+    mode_t get_mode(void) const { return mode; }
+    // the whole window is kept in memory, so it is limited by window_memory
+    uint32_t max_window(void) const;
+
+    // computes derived quantity for given simulation step and uploads it to texture
+    // incomplete frames (still being written) are skipped, result of the last complete one stays in texture
+    void load_frame(unsigned int step);
+    // true if texture holds result of current mode and settings, show raw values until then
+    bool has_result(void) const { return mode != none && state_valid; }
+    // binds result to texture_unit, texture unit 0 is active after return
+    void bind(void) const;
+
+    // unit sampled by texture_of_derived in fragment_scanner.glsl, unit 0 belongs to scanner itself
+    static constexpr GLuint texture_unit = 1;
+
+    // "none", "diff", "rms" or "peak", returns false if name is unknown
+    static bool parse_mode(const std::string& name, mode_t& mode);
+
+private:
+    bool read_frame(uint32_t index, float* dst) const;
+    void reset_state(void);
+    bool advance(uint32_t index);
+    bool retreat(void);
+    void resum(void);
+    uint32_t rebuild_depth(void) const;
+    void upload(void);
+
+    std::string file_name;
+    int fd = -1;
+    uint32_t size_x, size_y;
+    size_t pixels;
+    uint32_t store_every_nth_frame;
+
+    mode_t mode = none;
+    uint32_t window = 16; // RMS window, also number of results kept in peak hold history
+    float decay = 0.95f;
+    static constexpr size_t window_memory = (size_t)256 << 20; // bytes of history one scanner may keep
+    static constexpr uint32_t window_limit = 4096; // upper limit even for tiny scanners
+    static constexpr double peak_epsilon = 1e-4; // peak hold rebuild ignores peaks decayed below this fraction
+    unsigned int reference_step = 0;
+
+    bool state_valid = false; // true if "output" (and window state) belongs to frame "last_index"
+    bool reference_valid = false;
+    uint32_t last_index = 0; // index of stored frame in file (not simulation step)
+
+    std::vector<float> current;
+    std::vector<float> output;
+    std::vector<float> reference;
+    std::vector<float> ring; // RMS: last "window" frames, peak hold: last "window" results; ring_pos is the oldest one
+    std::vector<float> sum_sq; // sum of squares of all frames in ring (RMS)
+    uint32_t ring_pos = 0;
+    uint32_t ring_filled = 0;
+    uint32_t updates = 0; // incremental updates of sum_sq since it was summed from scratch
+
+    GLuint texture = 0;
+};
@@ -3,6 +3,10 @@
 in vec2 tex_coord; // input variable from vertex shader (same name and type)
 
 uniform sampler2D texture_of_values;
+uniform sampler2D texture_of_derived; // derived quantity computed on CPU, float texture (not saturated)
+uniform int derived_mode = 0; // 0 - raw values, else derived quantity is shown
+uniform sampler2D texture_of_followed; // raw values loaded in follow mode, float texture (not saturated)
+uniform int followed = 0; // 1 - raw values come from texture_of_followed instead of texture_of_values
 
 out vec4 FragColor;
 
@@ -10,8 +14,15 @@ const float color_gain = 1.0f;
 
 void main()
 {
-    float s_value = texture(texture_of_values, tex_coord).r;
-    s_value = (s_value * 2.0f) - 1.0f; // textures are saturated by OpenGL to 0 .. 1
+    float s_value;
+    if (derived_mode != 0) {
+        s_value = texture(texture_of_derived, tex_coord).r;
+    } else if (followed != 0) {
+        s_value = texture(texture_of_followed, tex_coord).r;
+    } else {
+        s_value = texture(texture_of_values, tex_coord).r;
+        s_value = (s_value * 2.0f) - 1.0f; // textures are saturated by OpenGL to 0 .. 1
+    }
     s_value = clamp(color_gain * s_value, -1.0f, 1.0f);
     FragColor = vec4((s_value < 0 ? 0.12f * (-s_value) : s_value), 1.0f + s_value , 1.0f - (s_value < 0 ? 0.5f * s_value : s_value), 1.0f);
 }
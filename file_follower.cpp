@@ -0,0 +1,190 @@
+#include "file_follower.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+    #include <sys/inotify.h>
+#endif /* __linux__ */
+
+file_follower::file_follower(const std::string& file_name, uint32_t size_x, uint32_t size_y, uint32_t store_every_nth_frame)
+    : file_name(file_name), size_x(size_x), size_y(size_y), store_every_nth_frame(store_every_nth_frame)
+{
+    data.assign((size_t)size_x * size_y, 0.0f);
+    frame_bytes = std::max(data.size() * sizeof(float), (size_t)1);
+    if(this->store_every_nth_frame < 1)
+        this->store_every_nth_frame = 1;
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif /* __linux__ */
+    // simulation may not have created the file yet, update() will try again later
+    if(try_open())
+        file_grown();
+    upload(); // zeros until first frame is loaded
+}
+
+file_follower::~file_follower()
+{
+    close_file();
+    if(inotify_fd >= 0)
+        close(inotify_fd);
+    if(texture)
+        glDeleteTextures(1, &texture);
+}
+
+void file_follower::close_file(void)
+{
+#ifdef __linux__
+    if(inotify_fd >= 0 && watch_fd >= 0)
+        inotify_rm_watch(inotify_fd, watch_fd);
+#endif /* __linux__ */
+    watch_fd = -1;
+    if(fd >= 0)
+        close(fd);
+    fd = -1;
+    frame_loaded = false;
+}
+
+bool file_follower::try_open(void)
+{
+    fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+#ifdef __linux__
+    if(inotify_fd >= 0)
+    {
+        watch_fd = inotify_add_watch(inotify_fd, file_name.c_str(), IN_MODIFY | IN_ATTRIB);
+        if(watch_fd < 0)
+        {
+            // watch limit reached etc. - stat file on every update instead
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+    }
+#endif /* __linux__ */
+    return true;
+}
+
+// re-reads file size, returns true if number of complete frames has changed
+bool file_follower::file_grown(void)
+{
+    struct stat st;
+    uint32_t new_frames;
+
+    if(fstat(fd, &st) != 0)
+        return false;
+    // trailing partially written frame is ignored
+    new_frames = (uint32_t)((size_t)st.st_size / frame_bytes);
+    if(new_frames == frames)
+        return false;
+    if(new_frames < frames)
+        frame_loaded = false; // truncated - simulation restarted in place, loaded frame may be rewritten
+    frames = new_frames;
+    return true;
+}
+
+bool file_follower::update(void)
+{
+    struct stat st;
+
+    if(fd < 0)
+    {
+        if(!try_open())
+            return false;
+        return file_grown();
+    }
+
+#ifdef __linux__
+    if(inotify_fd >= 0)
+    {
+        // drain all pending events, nothing blocks thanks to IN_NONBLOCK
+        alignas(struct inotify_event) char buf[4096];
+        bool changed = false;
+        ssize_t len;
+
+        while((len = read(inotify_fd, buf, sizeof(buf))) > 0)
+        {
+            changed = true;
+        }
+        if(!changed)
+            return false;
+    }
+#endif /* __linux__ */
+
+    if(fstat(fd, &st) == 0 && st.st_nlink == 0)
+    {
+        // simulation was restarted and file re-created - follow the new one from beginning
+        close_file();
+        frames = 0;
+        if(try_open())
+            file_grown();
+        // don't show frame of previous run
+        std::fill(data.begin(), data.end(), 0.0f);
+        upload();
+        return true;
+    }
+
+    return file_grown();
+}
+
+bool file_follower::newest_frame(unsigned int& step) const
+{
+    if(frames < 1)
+        return false;
+    step = (frames - 1) * store_every_nth_frame;
+    return true;
+}
+
+bool file_follower::load_frame(unsigned int step)
+{
+    uint32_t index = step / store_every_nth_frame;
+    size_t done = 0;
+    ssize_t len;
+
+    if(frame_loaded && index == loaded_index)
+        return true;
+    if(fd < 0 || index >= frames)
+        return false;
+    // frame is complete (counted by update()), so this never waits for simulation
+    while(done < frame_bytes)
+    {
+        len = pread(fd, (char*)data.data() + done, frame_bytes - done, (off_t)index * frame_bytes + done);
+        if(len <= 0)
+            return false; // file truncated meanwhile - next update() sorts it out
+        done += len;
+    }
+    upload();
+    loaded_index = index;
+    frame_loaded = true;
+    return true;
+}
+
+void file_follower::upload(void)
+{
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    if(!texture)
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // float texture - raw values, NOT saturated to 0 .. 1 (unlike scanner texture)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size_x, size_y, 0, GL_RED, GL_FLOAT, data.data());
+    }
+    else
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size_x, size_y, GL_RED, GL_FLOAT, data.data());
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void file_follower::bind(void) const
+{
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glActiveTexture(GL_TEXTURE0);
+}
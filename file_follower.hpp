@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <glad/glad.h>
+
+// Watches scanner output file (.f32) which is still being written by running simulation.
+// Keeps the file open and counts complete frames only, so the render loop never touches
+// partially written frame. On Linux file growth is reported by inotify, elsewhere (e.g. Cygwin)
+// file size is simply checked on every update.
+// f3d::scanner knows only frames present at startup, so followed frames are read from the
+// follower's own descriptor and uploaded into its own R32F texture.
+class file_follower
+{
+public:
+    // size_x, size_y: scanner size, one stored frame is size_x * size_y floats
+    // store_every_nth_frame: the same as passed to scanner, converts stored frames to simulation steps
+    file_follower(const std::string& file_name, uint32_t size_x, uint32_t size_y, uint32_t store_every_nth_frame = 1);
+    ~file_follower();
+    file_follower(const file_follower&) = delete;
+    file_follower& operator=(const file_follower&) = delete;
+
+    // non-blocking, call once per rendered frame
+    // returns true if new complete frame(s) appeared since last call
+    bool update(void);
+    // number of complete frames currently stored in file
+    uint32_t complete_frames(void) const { return frames; }
+    // simulation step of newest complete frame, returns false if no complete frame is in file yet
+    bool newest_frame(unsigned int& step) const;
+    // reads frame of given simulation step and uploads it to texture, does nothing if it is already there
+    // returns false if frame is not complete in file (texture keeps previous content)
+    bool load_frame(unsigned int step);
+    // binds texture to texture_unit, texture unit 0 is active after return
+    void bind(void) const;
+
+    // unit sampled by texture_of_followed in fragment_scanner.glsl
+    static constexpr GLuint texture_unit = 2;
+
+private:
+    bool try_open(void);
+    void close_file(void);
+    bool file_grown(void);
+    void upload(void);
+
+    std::string file_name;
+    uint32_t size_x, size_y;
+    size_t frame_bytes;
+    uint32_t store_every_nth_frame;
+    uint32_t frames = 0;
+    int fd = -1; // file itself, stays open until simulation replaces it
+    int inotify_fd = -1; // -1 if inotify is not available - fall back to fstat() on every update
+    int watch_fd = -1;
+
+    bool frame_loaded = false; // true if texture holds frame "loaded_index" of currently opened file
+    uint32_t loaded_index = 0;
+    std::vector<float> data;
+    GLuint texture = 0;
+};